@@ -24,7 +24,8 @@ extern "C"
   
   //! Convert from YUYV to RGB, mostly intended for internal use. Use RawImage functions instead in most cases.
   /*! This code is modified from here: http://pastebin.com/mDcwqJV3
-      Memory should have been allocated by caller. \ingroup image */
+      Memory should have been allocated by caller. Odd widths are supported, in which case the last pixel of each row
+      (which only has Y and U) re-uses the V value of the pixel pair to its left. \ingroup image */
   void convertYUYVtoRGB24(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
   
   //! Convert from YUYV to RG, BY, and luminance for use by Saliency module in jevoisbase. For internal use.
@@ -32,6 +33,65 @@ extern "C"
   void convertYUYVtoRGBYL(unsigned int w, unsigned int h, unsigned char const * src, int * dstrg,
                           int * dstby, int * dstlum, int thresh, int inputbits);
 
+  //! Convert from big-endian RGB565 (as output by the camera sensor) to packed RGB, for internal use
+  /*! \ingroup image */
+  void convertRGB565toRGB24(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from big-endian RGB565 (as output by the camera sensor) to packed BGR, for internal use
+  /*! \ingroup image */
+  void convertRGB565toBGR24(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from big-endian RGB565 (as output by the camera sensor) to packed RGBA with A=255, for internal use
+  /*! \ingroup image */
+  void convertRGB565toRGBA32(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from big-endian RGB565 (as output by the camera sensor) to grey, as (R+G+B)/3, for internal use
+  /*! \ingroup image */
+  void convertRGB565toGRAY(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from packed RGB to YUYV, for internal use
+  /*! U is taken from the first pixel of each pair and V from the second. If w is odd, the last pixel of each row only
+      gets its Y and U bytes written. \ingroup image */
+  void convertRGB24toYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from packed BGR to YUYV, for internal use
+  /*! See convertRGB24toYUYV() for details. \ingroup image */
+  void convertBGR24toYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from packed RGBA to YUYV (alpha is ignored), for internal use
+  /*! See convertRGB24toYUYV() for details. \ingroup image */
+  void convertRGBA32toYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from grey to YUYV, for internal use
+  /*! \ingroup image */
+  void convertGRAYtoYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst);
+
+  //! Convert from packed RGB to RGGB Bayer, for internal use
+  /*! y0 is the row number of the first row of src within the full image, and is used to select the Bayer pattern of
+      each row when converting a band of rows out of a larger image. \ingroup image */
+  void convertRGB24toBayer(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                           unsigned int y0);
+
+  //! Convert from packed BGR to RGGB Bayer, for internal use
+  /*! See convertRGB24toBayer() for details. \ingroup image */
+  void convertBGR24toBayer(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                           unsigned int y0);
+
+  //! Convert from packed RGBA to RGGB Bayer (alpha is ignored), for internal use
+  /*! See convertRGB24toBayer() for details. \ingroup image */
+  void convertRGBA32toBayer(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                            unsigned int y0);
+
+  //! Enable or disable the use of SIMD instructions by the color conversion functions
+  /*! SIMD is enabled by default whenever the CPU supports it (NEON on platform, SSE2/SSSE3 on Intel hosts, as
+      detected at runtime). The scalar code gives bit-identical results and is mainly useful for testing and
+      benchmarking. \ingroup image */
+  void setColorConversionSIMD(int enable);
+
+  //! Get the name of the SIMD instruction set used by the color conversion functions, or "none"
+  /*! \ingroup image */
+  char const * colorConversionSIMD(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,52 +16,401 @@
 /*! \file */
 
 #include <jevois/Image/ColorConversion.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JEVOIS_CC_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define JEVOIS_CC_SSE
+#endif
 
 #define CLAMP(value) if (value < 0) value = 0; else if (value > 255) value = 255;
 
+// YUYV to RGB fixed-point coefficients, with 16 bits of fractional precision:
+#define K1 ((int)(1.402f * (1 << 16)))
+#define K2 ((int)(0.714f * (1 << 16)))
+#define K3 ((int)(0.334f * (1 << 16)))
+#define K4 ((int)(1.772f * (1 << 16)))
+
+// RGB to YUV fixed-point coefficients, with 15 bits of fractional precision (so that they fit in a signed short, as
+// needed by the SIMD code):
+#define YR 8421   /* 0.257 */
+#define YG 16515  /* 0.504 */
+#define YB 3211   /* 0.098 */
+#define UR -4850  /* -0.148 */
+#define UG -9535  /* -0.291 */
+#define UB 14385  /* 0.439 */
+#define VR 14385  /* 0.439 */
+#define VG -12059 /* -0.368 */
+#define VB -2327  /* -0.071 */
+#define YOFF (16 << 15)
+#define UVOFF (128 << 15)
+
+// ####################################################################################################
+// SIMD dispatch: level is decided once at runtime and may be turned down to scalar by setColorConversionSIMD()
+enum { JEVOIS_CC_SCALAR = 0, JEVOIS_CC_SIMD = 1, JEVOIS_CC_SIMD_SHUFFLE = 2 };
+
+static pthread_once_t jevois_cc_once = PTHREAD_ONCE_INIT;
+static int jevois_cc_level = JEVOIS_CC_SCALAR; // best level supported by the CPU, set by jevois_cc_init()
+static int jevois_cc_enabled = 1; // user override, only accessed atomically
+
+#ifdef JEVOIS_CC_SSE
+// Shuffle masks for 16-pixel deinterleave (3 channels from 3 input registers) and interleave (3 output registers from 3
+// channel registers) of packed 24-bit pixels, computed once by jevois_cc_init():
+static __m128i jevois_cc_deint[3][3];
+static __m128i jevois_cc_inter[3][3];
+#endif
+
+static void jevois_cc_init(void)
+{
+#if defined(JEVOIS_CC_NEON)
+  jevois_cc_level = JEVOIS_CC_SIMD_SHUFFLE; // NEON is mandatory on the platform, and has native (de)interleave
+#elif defined(JEVOIS_CC_SSE)
+  int c, j, k;
+  for (c = 0; c < 3; ++c)
+    for (j = 0; j < 3; ++j)
+    {
+      signed char d[16], i[16];
+      for (k = 0; k < 16; ++k)
+      {
+        int const n = 3 * k + c; // source byte of channel c of pixel k
+        d[k] = (n >> 4) == j ? (n & 15) : -128;
+
+        int const m = 16 * j + k; // output byte m of 48, is channel m%3 of pixel m/3
+        i[k] = (m % 3) == c ? m / 3 : -128;
+      }
+      jevois_cc_deint[c][j] = _mm_loadu_si128((__m128i const *)d);
+      jevois_cc_inter[j][c] = _mm_loadu_si128((__m128i const *)i);
+    }
+
+  __builtin_cpu_init();
+  jevois_cc_level = __builtin_cpu_supports("ssse3") ? JEVOIS_CC_SIMD_SHUFFLE : JEVOIS_CC_SIMD;
+#endif
+}
+
+static inline int simdLevel(void)
+{
+  pthread_once(&jevois_cc_once, &jevois_cc_init);
+  return __atomic_load_n(&jevois_cc_enabled, __ATOMIC_RELAXED) ? jevois_cc_level : JEVOIS_CC_SCALAR;
+}
+
+// ####################################################################################################
+void setColorConversionSIMD(int enable)
+{
+  __atomic_store_n(&jevois_cc_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+// ####################################################################################################
+char const * colorConversionSIMD(void)
+{
+  switch (simdLevel())
+  {
+#if defined(JEVOIS_CC_NEON)
+  case JEVOIS_CC_SIMD_SHUFFLE: return "NEON";
+#elif defined(JEVOIS_CC_SSE)
+  case JEVOIS_CC_SIMD: return "SSE2";
+  case JEVOIS_CC_SIMD_SHUFFLE: return "SSE2+SSSE3";
+#endif
+  default: return "none";
+  }
+}
+
+// ####################################################################################################
+// SIMD helpers
+// ####################################################################################################
+#ifdef JEVOIS_CC_SSE
+// Fixed-point (K * v) >> 16 for signed 16-bit v and 32-bit K, bit-exact with the scalar int code. We split K into m *
+// 65536 + r with r fitting in a signed short, so that (K * v) >> 16 = m * v + ((r * v) >> 16):
+static inline __m128i mulK(__m128i v, int K)
+{
+  int const m = (K + 32768) >> 16; int const r = K - m * 65536;
+  return _mm_add_epi16(_mm_mullo_epi16(v, _mm_set1_epi16(m)), _mm_mulhi_epi16(v, _mm_set1_epi16(r)));
+}
+
+// Split 16 packed 24-bit pixels into 3 channel registers:
+__attribute__((target("ssse3")))
+static inline void deinterleave3(unsigned char const * src, __m128i * c0, __m128i * c1, __m128i * c2)
+{
+  __m128i const a = _mm_loadu_si128((__m128i const *)src);
+  __m128i const b = _mm_loadu_si128((__m128i const *)(src + 16));
+  __m128i const c = _mm_loadu_si128((__m128i const *)(src + 32));
+  __m128i * out[3] = { c0, c1, c2 };
+  int ch;
+  for (ch = 0; ch < 3; ++ch)
+    *out[ch] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, jevois_cc_deint[ch][0]),
+                                         _mm_shuffle_epi8(b, jevois_cc_deint[ch][1])),
+                            _mm_shuffle_epi8(c, jevois_cc_deint[ch][2]));
+}
+
+// Store 16 pixels given as 3 channel registers as packed 24-bit pixels:
+__attribute__((target("ssse3")))
+static inline void interleave3(unsigned char * dst, __m128i c0, __m128i c1, __m128i c2)
+{
+  int j;
+  for (j = 0; j < 3; ++j)
+    _mm_storeu_si128((__m128i *)(dst + 16 * j),
+                     _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c0, jevois_cc_inter[j][0]),
+                                               _mm_shuffle_epi8(c1, jevois_cc_inter[j][1])),
+                                  _mm_shuffle_epi8(c2, jevois_cc_inter[j][2])));
+}
+
+// Extract channel number ch (0..3) of 16 packed 32-bit pixels, as 8-bit values:
+static inline __m128i channel4(unsigned char const * src, int ch)
+{
+  __m128i const m = _mm_set1_epi32(0xff);
+  __m128i const a = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((__m128i const *)src), 8 * ch), m);
+  __m128i const b = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((__m128i const *)(src + 16)), 8 * ch), m);
+  __m128i const c = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((__m128i const *)(src + 32)), 8 * ch), m);
+  __m128i const d = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((__m128i const *)(src + 48)), 8 * ch), m);
+  return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+}
+
+// Decode 16 big-endian RGB565 pixels into 8-bit R, G, B:
+static inline void rgb565pix16(unsigned char const * src, __m128i * r, __m128i * g, __m128i * b)
+{
+  __m128i rr[2], gg[2], bb[2];
+  int i;
+  for (i = 0; i < 2; ++i)
+  {
+    __m128i v = _mm_loadu_si128((__m128i const *)(src + 16 * i));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    __m128i const r5 = _mm_srli_epi16(v, 11);
+    __m128i const g6 = _mm_and_si128(_mm_srli_epi16(v, 5), _mm_set1_epi16(0x3f));
+    __m128i const b5 = _mm_and_si128(v, _mm_set1_epi16(0x1f));
+    rr[i] = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(r5, _mm_set1_epi16(527)), _mm_set1_epi16(23)), 6);
+    gg[i] = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g6, _mm_set1_epi16(259)), _mm_set1_epi16(33)), 6);
+    bb[i] = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(b5, _mm_set1_epi16(527)), _mm_set1_epi16(23)), 6);
+  }
+  *r = _mm_packus_epi16(rr[0], rr[1]); *g = _mm_packus_epi16(gg[0], gg[1]); *b = _mm_packus_epi16(bb[0], bb[1]);
+}
+
+// Compute Y and alternating U/V for 8 pixels given as 16-bit R, G, B:
+static inline void rgbToYC8(__m128i r, __m128i g, __m128i b, __m128i * y, __m128i * c)
+{
+  __m128i const z = _mm_setzero_si128();
+  __m128i const rglo = _mm_unpacklo_epi16(r, g), rghi = _mm_unpackhi_epi16(r, g);
+  __m128i const bzlo = _mm_unpacklo_epi16(b, z), bzhi = _mm_unpackhi_epi16(b, z);
+
+  __m128i const yrg = _mm_setr_epi16(YR, YG, YR, YG, YR, YG, YR, YG);
+  __m128i const yb = _mm_setr_epi16(YB, 0, YB, 0, YB, 0, YB, 0);
+  __m128i const yoff = _mm_set1_epi32(YOFF);
+  __m128i const ylo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rglo, yrg), _mm_madd_epi16(bzlo, yb)),
+                                                   yoff), 15);
+  __m128i const yhi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rghi, yrg), _mm_madd_epi16(bzhi, yb)),
+                                                   yoff), 15);
+  *y = _mm_packs_epi32(ylo, yhi);
+
+  // Even pixels get U, odd pixels get V:
+  __m128i const crg = _mm_setr_epi16(UR, UG, VR, VG, UR, UG, VR, VG);
+  __m128i const cb = _mm_setr_epi16(UB, 0, VB, 0, UB, 0, VB, 0);
+  __m128i const coff = _mm_set1_epi32(UVOFF);
+  __m128i const clo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rglo, crg), _mm_madd_epi16(bzlo, cb)),
+                                                   coff), 15);
+  __m128i const chi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rghi, crg), _mm_madd_epi16(bzhi, cb)),
+                                                   coff), 15);
+  *c = _mm_packs_epi32(clo, chi);
+}
+
+// Convert 16 pixels given as 8-bit R, G, B to 32 bytes of YUYV:
+static inline void rgbToYUYV16(__m128i r, __m128i g, __m128i b, unsigned char * dst)
+{
+  __m128i const z = _mm_setzero_si128();
+  __m128i y0, c0, y1, c1;
+  rgbToYC8(_mm_unpacklo_epi8(r, z), _mm_unpacklo_epi8(g, z), _mm_unpacklo_epi8(b, z), &y0, &c0);
+  rgbToYC8(_mm_unpackhi_epi8(r, z), _mm_unpackhi_epi8(g, z), _mm_unpackhi_epi8(b, z), &y1, &c1);
+  __m128i const y = _mm_packus_epi16(y0, y1), c = _mm_packus_epi16(c0, c1);
+  _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(y, c));
+  _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(y, c));
+}
+
+// Bayer row from 16 pixels given as 8-bit R, G, B:
+static inline __m128i rgbToBayer16(__m128i r, __m128i g, __m128i b, unsigned int oddrow)
+{
+  __m128i const even = _mm_set1_epi16(0x00ff);
+  if (oddrow) return _mm_or_si128(_mm_and_si128(even, g), _mm_andnot_si128(even, b));
+  return _mm_or_si128(_mm_and_si128(even, r), _mm_andnot_si128(even, g));
+}
+#endif // JEVOIS_CC_SSE
+
+#ifdef JEVOIS_CC_NEON
+// Fixed-point (K * v) >> 16 for signed 16-bit v and 32-bit K, bit-exact with the scalar int code. We split K into m *
+// 65536 + r with r fitting in a signed short, so that (K * v) >> 16 = m * v + ((r * v) >> 16):
+static inline int16x8_t mulK(int16x8_t v, int K)
+{
+  int const m = (K + 32768) >> 16; int16_t const r = K - m * 65536;
+  int16x8_t const hi = vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(v), r), 16),
+                                    vshrn_n_s32(vmull_n_s16(vget_high_s16(v), r), 16));
+  return vmlaq_n_s16(hi, v, m);
+}
+
+// Expand an RGB565 component to 8 bits, computing ((x * mul) + add) >> 6:
+static inline uint8x16_t expand565(uint8x16_t x, uint16_t mul, uint16_t add)
+{
+  uint16x8_t const a = vdupq_n_u16(add);
+  return vcombine_u8(vshrn_n_u16(vmlaq_n_u16(a, vmovl_u8(vget_low_u8(x)), mul), 6),
+                     vshrn_n_u16(vmlaq_n_u16(a, vmovl_u8(vget_high_u8(x)), mul), 6));
+}
+
+// Decode 16 big-endian RGB565 pixels into 8-bit R, G, B:
+static inline void rgb565pix16(unsigned char const * src, uint8x16_t * r, uint8x16_t * g, uint8x16_t * b)
+{
+  uint8x16x2_t const p = vld2q_u8(src); // val[0] is the high byte (RRRRRGGG), val[1] the low byte (GGGBBBBB)
+  uint8x16_t const r5 = vshrq_n_u8(p.val[0], 3);
+  uint8x16_t const g6 = vorrq_u8(vshlq_n_u8(vandq_u8(p.val[0], vdupq_n_u8(7)), 3), vshrq_n_u8(p.val[1], 5));
+  uint8x16_t const b5 = vandq_u8(p.val[1], vdupq_n_u8(0x1f));
+  *r = expand565(r5, 527, 23); *g = expand565(g6, 259, 33); *b = expand565(b5, 527, 23);
+}
+
+// Y and alternating U/V for 4 pixels given as 16-bit R, G, B:
+static inline void rgbToYC4(int16x4_t r, int16x4_t g, int16x4_t b, int16x4_t * y, int16x4_t * c)
+{
+  static int16_t const crc[4] = { UR, VR, UR, VR };
+  static int16_t const cgc[4] = { UG, VG, UG, VG };
+  static int16_t const cbc[4] = { UB, VB, UB, VB };
+
+  int32x4_t yy = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(vdupq_n_s32(YOFF), r, YR), g, YG), b, YB);
+  *y = vshrn_n_s32(yy, 15);
+
+  int32x4_t cc = vmlal_s16(vmlal_s16(vmlal_s16(vdupq_n_s32(UVOFF), r, vld1_s16(crc)), g, vld1_s16(cgc)),
+                           b, vld1_s16(cbc));
+  *c = vshrn_n_s32(cc, 15);
+}
+
+// Convert 8 pixels given as 8-bit R, G, B to 16 bytes of YUYV:
+static inline void rgbToYUYV8(uint8x8_t r8, uint8x8_t g8, uint8x8_t b8, unsigned char * dst)
+{
+  int16x8_t const r = vreinterpretq_s16_u16(vmovl_u8(r8));
+  int16x8_t const g = vreinterpretq_s16_u16(vmovl_u8(g8));
+  int16x8_t const b = vreinterpretq_s16_u16(vmovl_u8(b8));
+  int16x4_t y0, c0, y1, c1;
+  rgbToYC4(vget_low_s16(r), vget_low_s16(g), vget_low_s16(b), &y0, &c0);
+  rgbToYC4(vget_high_s16(r), vget_high_s16(g), vget_high_s16(b), &y1, &c1);
+  uint8x8x2_t o;
+  o.val[0] = vqmovun_s16(vcombine_s16(y0, y1));
+  o.val[1] = vqmovun_s16(vcombine_s16(c0, c1));
+  vst2_u8(dst, o);
+}
+
+// Bayer row from 16 pixels given as 8-bit R, G, B:
+static inline uint8x16_t rgbToBayer16(uint8x16_t r, uint8x16_t g, uint8x16_t b, unsigned int oddrow)
+{
+  uint8x16_t const even = vreinterpretq_u8_u16(vdupq_n_u16(0x00ff));
+  return oddrow ? vbslq_u8(even, g, b) : vbslq_u8(even, r, g);
+}
+#endif // JEVOIS_CC_NEON
+
+// ####################################################################################################
+// YUYV to RGB
+// ####################################################################################################
+static inline void yuyvToRGBpix(int Y, int uf, int vf, unsigned char * dst)
+{
+  int R = Y + (K1 * vf >> 16);
+  int G = Y - (K2 * vf >> 16) - (K3 * uf >> 16);
+  int B = Y + (K4 * uf >> 16);
+  CLAMP(R); CLAMP(G); CLAMP(B);
+  dst[0] = (unsigned char)(R); dst[1] = (unsigned char)(G); dst[2] = (unsigned char)(B);
+}
+
+// Process one row, starting at pixel x (which must be even), returns nothing as all pixels get done:
+static void yuyvToRGB24rowScalar(unsigned int x, unsigned int w, unsigned char const * src, unsigned char * dst)
+{
+  src += x * 2; dst += x * 3;
+
+  for ( ; x + 1 < w; x += 2)  // Y1 U Y2 V
+  {
+    int const uf = src[1] - 128, vf = src[3] - 128;
+    yuyvToRGBpix(src[0], uf, vf, dst);
+    yuyvToRGBpix(src[2], uf, vf, dst + 3);
+    src += 4; dst += 6;
+  }
+
+  // Odd width: last pixel is Y U, borrow V from the previous pair if any:
+  if (x < w) yuyvToRGBpix(src[0], src[1] - 128, w > 1 ? src[-1] - 128 : 0, dst);
+}
+
+// Process as many pixels of one row as possible with SIMD, returns number of pixels processed:
+static unsigned int yuyvToRGB24rowSIMD(unsigned int w, unsigned char const * src, unsigned char * dst)
+{
+  unsigned int x = 0;
+#if defined(JEVOIS_CC_NEON)
+  for ( ; x + 16 <= w; x += 16, src += 32, dst += 48)
+  {
+    uint8x8x4_t const p = vld4_u8(src); // Y1, U, Y2, V for 8 pixel pairs
+    int16x8_t const uf = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(p.val[1])), vdupq_n_s16(128));
+    int16x8_t const vf = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(p.val[3])), vdupq_n_s16(128));
+    int16x8_t const rt = mulK(vf, K1);
+    int16x8_t const gt = vnegq_s16(vaddq_s16(mulK(vf, K2), mulK(uf, K3)));
+    int16x8_t const bt = mulK(uf, K4);
+    int16x8_t const y1 = vreinterpretq_s16_u16(vmovl_u8(p.val[0]));
+    int16x8_t const y2 = vreinterpretq_s16_u16(vmovl_u8(p.val[2]));
+
+    uint8x8x2_t const r = vzip_u8(vqmovun_s16(vaddq_s16(y1, rt)), vqmovun_s16(vaddq_s16(y2, rt)));
+    uint8x8x2_t const g = vzip_u8(vqmovun_s16(vaddq_s16(y1, gt)), vqmovun_s16(vaddq_s16(y2, gt)));
+    uint8x8x2_t const b = vzip_u8(vqmovun_s16(vaddq_s16(y1, bt)), vqmovun_s16(vaddq_s16(y2, bt)));
+
+    uint8x16x3_t o;
+    o.val[0] = vcombine_u8(r.val[0], r.val[1]);
+    o.val[1] = vcombine_u8(g.val[0], g.val[1]);
+    o.val[2] = vcombine_u8(b.val[0], b.val[1]);
+    vst3q_u8(dst, o);
+  }
+#elif defined(JEVOIS_CC_SSE)
+  __m128i const m8 = _mm_set1_epi32(0xff), c128 = _mm_set1_epi16(128);
+  for ( ; x + 16 <= w; x += 16, src += 32, dst += 48)
+  {
+    __m128i const a = _mm_loadu_si128((__m128i const *)src), b = _mm_loadu_si128((__m128i const *)(src + 16));
+    __m128i const y1 = _mm_packs_epi32(_mm_and_si128(a, m8), _mm_and_si128(b, m8));
+    __m128i const uf = _mm_sub_epi16(_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), m8),
+                                                     _mm_and_si128(_mm_srli_epi32(b, 8), m8)), c128);
+    __m128i const y2 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), m8),
+                                       _mm_and_si128(_mm_srli_epi32(b, 16), m8));
+    __m128i const vf = _mm_sub_epi16(_mm_packs_epi32(_mm_srli_epi32(a, 24), _mm_srli_epi32(b, 24)), c128);
+
+    __m128i const rt = mulK(vf, K1);
+    __m128i const gt = _mm_sub_epi16(_mm_setzero_si128(), _mm_add_epi16(mulK(vf, K2), mulK(uf, K3)));
+    __m128i const bt = mulK(uf, K4);
+
+    __m128i const r1 = _mm_packus_epi16(_mm_add_epi16(y1, rt), _mm_add_epi16(y1, rt));
+    __m128i const r2 = _mm_packus_epi16(_mm_add_epi16(y2, rt), _mm_add_epi16(y2, rt));
+    __m128i const g1 = _mm_packus_epi16(_mm_add_epi16(y1, gt), _mm_add_epi16(y1, gt));
+    __m128i const g2 = _mm_packus_epi16(_mm_add_epi16(y2, gt), _mm_add_epi16(y2, gt));
+    __m128i const b1 = _mm_packus_epi16(_mm_add_epi16(y1, bt), _mm_add_epi16(y1, bt));
+    __m128i const b2 = _mm_packus_epi16(_mm_add_epi16(y2, bt), _mm_add_epi16(y2, bt));
+
+    interleave3(dst, _mm_unpacklo_epi8(r1, r2), _mm_unpacklo_epi8(g1, g2), _mm_unpacklo_epi8(b1, b2));
+  }
+#else
+  (void)w; (void)src; (void)dst;
+#endif
+  return x;
+}
+
 // ####################################################################################################
 void convertYUYVtoRGB24(unsigned int w, unsigned int h, unsigned char const * srcptr, unsigned char * dstptr)
 {
-  // FIXME This code does not work if w is odd
-  const int K1 = (int)(1.402f * (1 << 16));
-  const int K2 = (int)(0.714f * (1 << 16));
-  const int K3 = (int)(0.334f * (1 << 16));
-  const int K4 = (int)(1.772f * (1 << 16));
-  const unsigned int pitch = w * 2; // 2 bytes per one YU-YV pixel
-  unsigned int x, y;
-  unsigned char Y1, Y2;
-  int uf, vf, R, G, B;
-  
+  int const simd = (simdLevel() == JEVOIS_CC_SIMD_SHUFFLE);
+  unsigned int y;
+
   for (y = 0; y < h; ++y)
   {
-    for (x = 0; x < pitch; x += 4)  // Y1 U Y2 V
-    {
-      Y1 = *srcptr++; uf = *srcptr++ - 128; Y2 = *srcptr++; vf = *srcptr++ - 128;
- 
-      R = Y1 + (K1 * vf >> 16);
-      G = Y1 - (K2 * vf >> 16) - (K3 * uf >> 16);
-      B = Y1 + (K4 * uf >> 16);
-      CLAMP(R); CLAMP(G); CLAMP(B);
-      *dstptr++ = (unsigned char)(R); *dstptr++ = (unsigned char)(G); *dstptr++ = (unsigned char)(B);
- 
-      R = Y2 + (K1 * vf >> 16);
-      G = Y2 - (K2 * vf >> 16) - (K3 * uf >> 16);
-      B = Y2 + (K4 * uf >> 16);
-      CLAMP(R); CLAMP(G); CLAMP(B);
-      *dstptr++ = (unsigned char)(R); *dstptr++ = (unsigned char)(G); *dstptr++ = (unsigned char)(B);
-    }
+    unsigned int const x = simd ? yuyvToRGB24rowSIMD(w, srcptr, dstptr) : 0;
+    yuyvToRGB24rowScalar(x, w, srcptr, dstptr);
+    srcptr += w * 2; dstptr += w * 3;
   }
 }
 
 // ####################################################################################################
-inline void convertYUYVtoRGBYLinternal(int R, int G, int B, int * dstrg, int * dstby, int * dstlum,
-                                       int thresh, int lshift, int lumlshift)
+static inline void convertYUYVtoRGBYLinternal(int R, int G, int B, int * dstrg, int * dstby, int * dstlum,
+                                              int thresh, int lshift, int lumlshift)
 {
   CLAMP(R); CLAMP(G); CLAMP(B);
-  
+
   int L = R + G + B;
   *dstlum = (L / 3) << lumlshift;
-  
+
   if (L < thresh)
   {
     *dstrg = 0;
@@ -74,12 +423,12 @@ inline void convertYUYVtoRGBYLinternal(int R, int G, int B, int * dstrg, int * d
     int blue = (2 * B - R - G);
     int rg = R - G; if (rg < 0) rg = -rg;
     int yellow = -2 * blue - 4 * rg;
-    
+
     if (red < 0) red = 0;
     if (green < 0) green = 0;
     if (blue < 0) blue = 0;
     if (yellow < 0) yellow = 0;
-    
+
     *dstrg = (3 * (red - green) << lshift) / L;
     *dstby = (3 * (blue - yellow) << lshift) / L;
   }
@@ -89,25 +438,19 @@ inline void convertYUYVtoRGBYLinternal(int R, int G, int B, int * dstrg, int * d
 void convertYUYVtoRGBYL(unsigned int w, unsigned int h, unsigned char const * srcptr, int * dstrg,
                         int * dstby, int * dstlum, int thresh, int inputbits)
 {
-  // FIXME This code does not work if w is odd
-  const int K1 = (int)(1.402f * (1 << 16));
-  const int K2 = (int)(0.714f * (1 << 16));
-  const int K3 = (int)(0.334f * (1 << 16));
-  const int K4 = (int)(1.772f * (1 << 16));
-  const unsigned int pitch = w * 2; // 2 bytes per one YU-YV pixel
   const int lshift = inputbits - 3; // FIXME assumes inputbits > 3
   const int lumlshift = inputbits - 8; // FIXME assumes inputbits > 8; why two different shifts?
 
   unsigned int x, y;
   unsigned char Y1, Y2;
   int uf, vf, R, G, B;
-  
+
   for (y = 0; y < h; ++y)
   {
-    for (x = 0; x < pitch; x += 4)  // Y1 U Y2 V
+    for (x = 0; x + 1 < w; x += 2)  // Y1 U Y2 V
     {
       Y1 = *srcptr++; uf = *srcptr++ - 128; Y2 = *srcptr++; vf = *srcptr++ - 128;
- 
+
       R = Y1 + (K1 * vf >> 16);
       G = Y1 - (K2 * vf >> 16) - (K3 * uf >> 16);
       B = Y1 + (K4 * uf >> 16);
@@ -115,7 +458,7 @@ void convertYUYVtoRGBYL(unsigned int w, unsigned int h, unsigned char const * sr
       convertYUYVtoRGBYLinternal(R, G, B, dstrg, dstby, dstlum, thresh, lshift, lumlshift);
 
       ++dstrg; ++dstby; ++dstlum;
- 
+
       R = Y2 + (K1 * vf >> 16);
       G = Y2 - (K2 * vf >> 16) - (K3 * uf >> 16);
       B = Y2 + (K4 * uf >> 16);
@@ -124,5 +467,346 @@ void convertYUYVtoRGBYL(unsigned int w, unsigned int h, unsigned char const * sr
 
       ++dstrg; ++dstby; ++dstlum;
     }
+
+    // Odd width: last pixel is Y U, borrow V from the previous pair if any:
+    if (x < w)
+    {
+      vf = w > 1 ? srcptr[-1] - 128 : 0;
+      Y1 = *srcptr++; uf = *srcptr++ - 128;
+
+      R = Y1 + (K1 * vf >> 16);
+      G = Y1 - (K2 * vf >> 16) - (K3 * uf >> 16);
+      B = Y1 + (K4 * uf >> 16);
+
+      convertYUYVtoRGBYLinternal(R, G, B, dstrg, dstby, dstlum, thresh, lshift, lumlshift);
+
+      ++dstrg; ++dstby; ++dstlum;
+    }
+  }
+}
+
+// ####################################################################################################
+// RGB565 to RGB, BGR, RGBA, and grey
+// ####################################################################################################
+// Camera outputs big-endian RGB565 pixels:
+static inline void rgb565pix(unsigned char const * src, unsigned char * r, unsigned char * g, unsigned char * b)
+{
+  unsigned short const rgb565 = ((unsigned short)(src[0]) << 8) | src[1];
+  *r = ((((rgb565 >> 11) & 0x1F) * 527) + 23) >> 6;
+  *g = ((((rgb565 >> 5) & 0x3F) * 259) + 33) >> 6;
+  *b = (((rgb565 & 0x1F) * 527) + 23) >> 6;
+}
+
+// Dest pixel types for the RGB565 converters:
+enum { JEVOIS_CC_RGB, JEVOIS_CC_BGR, JEVOIS_CC_RGBA, JEVOIS_CC_GRAY };
+
+static void rgb565rowScalar(unsigned int x, unsigned int w, unsigned char const * src, unsigned char * dst, int type)
+{
+  unsigned char r, g, b;
+  src += x * 2;
+
+  switch (type)
+  {
+  case JEVOIS_CC_RGB:
+    for (dst += x * 3; x < w; ++x, src += 2, dst += 3) { rgb565pix(src, &r, &g, &b); dst[0]=r; dst[1]=g; dst[2]=b; }
+    break;
+  case JEVOIS_CC_BGR:
+    for (dst += x * 3; x < w; ++x, src += 2, dst += 3) { rgb565pix(src, &r, &g, &b); dst[0]=b; dst[1]=g; dst[2]=r; }
+    break;
+  case JEVOIS_CC_RGBA:
+    for (dst += x * 4; x < w; ++x, src += 2, dst += 4)
+    { rgb565pix(src, &r, &g, &b); dst[0] = r; dst[1] = g; dst[2] = b; dst[3] = 255; }
+    break;
+  case JEVOIS_CC_GRAY:
+    for (dst += x; x < w; ++x, src += 2, ++dst) { rgb565pix(src, &r, &g, &b); *dst = (int)(r + g + b) / 3; }
+    break;
+  }
+}
+
+static unsigned int rgb565rowSIMD(unsigned int w, unsigned char const * src, unsigned char * dst, int type, int lvl)
+{
+  unsigned int x = 0;
+#if defined(JEVOIS_CC_NEON)
+  (void)lvl;
+  for ( ; x + 16 <= w; x += 16, src += 32)
+  {
+    uint8x16_t r, g, b; rgb565pix16(src, &r, &g, &b);
+    switch (type)
+    {
+    case JEVOIS_CC_RGB: { uint8x16x3_t o; o.val[0]=r; o.val[1]=g; o.val[2]=b; vst3q_u8(dst, o); dst += 48; } break;
+    case JEVOIS_CC_BGR: { uint8x16x3_t o; o.val[0]=b; o.val[1]=g; o.val[2]=r; vst3q_u8(dst, o); dst += 48; } break;
+    case JEVOIS_CC_RGBA:
+    { uint8x16x4_t o; o.val[0]=r; o.val[1]=g; o.val[2]=b; o.val[3]=vdupq_n_u8(255); vst4q_u8(dst, o); dst += 64; }
+    break;
+    case JEVOIS_CC_GRAY:
+    {
+      // (r+g+b)/3 computed exactly as (sum * 0xaaab) >> 17:
+      uint16x8_t const slo = vaddw_u8(vaddl_u8(vget_low_u8(r), vget_low_u8(g)), vget_low_u8(b));
+      uint16x8_t const shi = vaddw_u8(vaddl_u8(vget_high_u8(r), vget_high_u8(g)), vget_high_u8(b));
+      uint16x4_t const l0 = vmovn_u32(vshrq_n_u32(vmull_n_u16(vget_low_u16(slo), 0xaaab), 17));
+      uint16x4_t const l1 = vmovn_u32(vshrq_n_u32(vmull_n_u16(vget_high_u16(slo), 0xaaab), 17));
+      uint16x4_t const l2 = vmovn_u32(vshrq_n_u32(vmull_n_u16(vget_low_u16(shi), 0xaaab), 17));
+      uint16x4_t const l3 = vmovn_u32(vshrq_n_u32(vmull_n_u16(vget_high_u16(shi), 0xaaab), 17));
+      vst1q_u8(dst, vcombine_u8(vmovn_u16(vcombine_u16(l0, l1)), vmovn_u16(vcombine_u16(l2, l3))));
+      dst += 16;
+    }
+    break;
+    }
+  }
+#elif defined(JEVOIS_CC_SSE)
+  // Packed 24-bit outputs need SSSE3 shuffles:
+  if ((type == JEVOIS_CC_RGB || type == JEVOIS_CC_BGR) && lvl != JEVOIS_CC_SIMD_SHUFFLE) return 0;
+
+  __m128i const z = _mm_setzero_si128();
+  for ( ; x + 16 <= w; x += 16, src += 32)
+  {
+    __m128i r, g, b; rgb565pix16(src, &r, &g, &b);
+    switch (type)
+    {
+    case JEVOIS_CC_RGB: interleave3(dst, r, g, b); dst += 48; break;
+    case JEVOIS_CC_BGR: interleave3(dst, b, g, r); dst += 48; break;
+    case JEVOIS_CC_RGBA:
+    {
+      __m128i const rg0 = _mm_unpacklo_epi8(r, g), rg1 = _mm_unpackhi_epi8(r, g);
+      __m128i const a = _mm_set1_epi8((char)255);
+      __m128i const ba0 = _mm_unpacklo_epi8(b, a), ba1 = _mm_unpackhi_epi8(b, a);
+      _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg0, ba0));
+      _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg0, ba0));
+      _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(rg1, ba1));
+      _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(rg1, ba1));
+      dst += 64;
+    }
+    break;
+    case JEVOIS_CC_GRAY:
+    {
+      // (r+g+b)/3 computed exactly as (sum * 0xaaab) >> 17:
+      __m128i const m = _mm_set1_epi16((short)0xaaab);
+      __m128i const s0 = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(r, z), _mm_unpacklo_epi8(g, z)),
+                                       _mm_unpacklo_epi8(b, z));
+      __m128i const s1 = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(r, z), _mm_unpackhi_epi8(g, z)),
+                                       _mm_unpackhi_epi8(b, z));
+      _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(_mm_srli_epi16(_mm_mulhi_epu16(s0, m), 1),
+                                                        _mm_srli_epi16(_mm_mulhi_epu16(s1, m), 1)));
+      dst += 16;
+    }
+    break;
+    }
   }
+#else
+  (void)w; (void)src; (void)dst; (void)type; (void)lvl;
+#endif
+  return x;
 }
+
+static void rgb565convert(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst, int type)
+{
+  int const lvl = simdLevel();
+  unsigned int const outbpp = (type == JEVOIS_CC_GRAY) ? 1 : (type == JEVOIS_CC_RGBA) ? 4 : 3;
+  unsigned int y;
+
+  for (y = 0; y < h; ++y)
+  {
+    unsigned int const x = lvl ? rgb565rowSIMD(w, src, dst, type, lvl) : 0;
+    rgb565rowScalar(x, w, src, dst, type);
+    src += w * 2; dst += w * outbpp;
+  }
+}
+
+// ####################################################################################################
+void convertRGB565toRGB24(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ rgb565convert(w, h, src, dst, JEVOIS_CC_RGB); }
+
+// ####################################################################################################
+void convertRGB565toBGR24(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ rgb565convert(w, h, src, dst, JEVOIS_CC_BGR); }
+
+// ####################################################################################################
+void convertRGB565toRGBA32(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ rgb565convert(w, h, src, dst, JEVOIS_CC_RGBA); }
+
+// ####################################################################################################
+void convertRGB565toGRAY(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ rgb565convert(w, h, src, dst, JEVOIS_CC_GRAY); }
+
+// ####################################################################################################
+// RGB, BGR, RGBA and grey to YUYV
+// ####################################################################################################
+static inline unsigned char rgbToY(int r, int g, int b) { return (YR * r + YG * g + YB * b + YOFF) >> 15; }
+static inline unsigned char rgbToU(int r, int g, int b) { return (UR * r + UG * g + UB * b + UVOFF) >> 15; }
+static inline unsigned char rgbToV(int r, int g, int b) { return (VR * r + VG * g + VB * b + UVOFF) >> 15; }
+
+// Source pixel layout is given by the byte offsets of R, G, B within each pixel, and the number of bytes per pixel:
+static void toYUYVrowScalar(unsigned int x, unsigned int w, unsigned char const * src, unsigned char * dst,
+                            int ro, int go, int bo, int bpp)
+{
+  src += x * bpp; dst += x * 2;
+
+  for ( ; x + 1 < w; x += 2)
+  {
+    unsigned char const * p2 = src + bpp;
+    dst[0] = rgbToY(src[ro], src[go], src[bo]);
+    dst[1] = rgbToU(src[ro], src[go], src[bo]);
+    dst[2] = rgbToY(p2[ro], p2[go], p2[bo]);
+    dst[3] = rgbToV(p2[ro], p2[go], p2[bo]);
+    src += 2 * bpp; dst += 4;
+  }
+
+  // Odd width: last pixel only gets Y and U:
+  if (x < w) { dst[0] = rgbToY(src[ro], src[go], src[bo]); dst[1] = rgbToU(src[ro], src[go], src[bo]); }
+}
+
+static unsigned int toYUYVrowSIMD(unsigned int w, unsigned char const * src, unsigned char * dst,
+                                  int ro, int go, int bo, int bpp, int lvl)
+{
+  unsigned int x = 0;
+#if defined(JEVOIS_CC_NEON)
+  (void)lvl;
+  if (bpp == 3)
+    for ( ; x + 8 <= w; x += 8, src += 24, dst += 16)
+    { uint8x8x3_t const p = vld3_u8(src); rgbToYUYV8(p.val[ro], p.val[go], p.val[bo], dst); }
+  else
+    for ( ; x + 8 <= w; x += 8, src += 32, dst += 16)
+    { uint8x8x4_t const p = vld4_u8(src); rgbToYUYV8(p.val[ro], p.val[go], p.val[bo], dst); }
+#elif defined(JEVOIS_CC_SSE)
+  if (bpp == 3)
+  {
+    if (lvl != JEVOIS_CC_SIMD_SHUFFLE) return 0;
+    for ( ; x + 16 <= w; x += 16, src += 48, dst += 32)
+    {
+      __m128i c[3]; deinterleave3(src, &c[0], &c[1], &c[2]);
+      rgbToYUYV16(c[ro], c[go], c[bo], dst);
+    }
+  }
+  else
+    for ( ; x + 16 <= w; x += 16, src += 64, dst += 32)
+      rgbToYUYV16(channel4(src, ro), channel4(src, go), channel4(src, bo), dst);
+#else
+  (void)w; (void)src; (void)dst; (void)ro; (void)go; (void)bo; (void)bpp; (void)lvl;
+#endif
+  return x;
+}
+
+static void toYUYVconvert(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                          int ro, int go, int bo, int bpp)
+{
+  int const lvl = simdLevel();
+  unsigned int y;
+
+  for (y = 0; y < h; ++y)
+  {
+    unsigned int const x = lvl ? toYUYVrowSIMD(w, src, dst, ro, go, bo, bpp, lvl) : 0;
+    toYUYVrowScalar(x, w, src, dst, ro, go, bo, bpp);
+    src += w * bpp; dst += w * 2;
+  }
+}
+
+// ####################################################################################################
+void convertRGB24toYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ toYUYVconvert(w, h, src, dst, 0, 1, 2, 3); }
+
+// ####################################################################################################
+void convertBGR24toYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ toYUYVconvert(w, h, src, dst, 2, 1, 0, 3); }
+
+// ####################################################################################################
+void convertRGBA32toYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{ toYUYVconvert(w, h, src, dst, 0, 1, 2, 4); }
+
+// ####################################################################################################
+void convertGRAYtoYUYV(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst)
+{
+  size_t const n = (size_t)w * h; // no dependency between rows here, process the image as one long row
+  size_t i = 0;
+
+  if (simdLevel())
+  {
+#if defined(JEVOIS_CC_NEON)
+    for ( ; i + 16 <= n; i += 16)
+    { uint8x16x2_t o; o.val[0] = vld1q_u8(src + i); o.val[1] = vdupq_n_u8(0x80); vst2q_u8(dst + 2 * i, o); }
+#elif defined(JEVOIS_CC_SSE)
+    __m128i const c = _mm_set1_epi8((char)0x80);
+    for ( ; i + 16 <= n; i += 16)
+    {
+      __m128i const g = _mm_loadu_si128((__m128i const *)(src + i));
+      _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(g, c));
+      _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(g, c));
+    }
+#endif
+  }
+
+  for ( ; i < n; ++i) { dst[2 * i] = src[i]; dst[2 * i + 1] = 0x80; }
+}
+
+// ####################################################################################################
+// RGB, BGR and RGBA to Bayer
+// ####################################################################################################
+// RGGB: even rows are R G R G ..., odd rows are G B G B ...
+static void toBayerrowScalar(unsigned int x, unsigned int w, unsigned char const * src, unsigned char * dst,
+                             int ro, int go, int bo, int bpp, unsigned int oddrow)
+{
+  int const o1 = oddrow ? go : ro, o2 = oddrow ? bo : go;
+  src += x * bpp; dst += x;
+
+  for ( ; x + 1 < w; x += 2) { dst[0] = src[o1]; dst[1] = src[bpp + o2]; src += 2 * bpp; dst += 2; }
+  if (x < w) dst[0] = src[o1];
+}
+
+static unsigned int toBayerrowSIMD(unsigned int w, unsigned char const * src, unsigned char * dst,
+                                   int ro, int go, int bo, int bpp, unsigned int oddrow, int lvl)
+{
+  unsigned int x = 0;
+#if defined(JEVOIS_CC_NEON)
+  (void)lvl;
+  if (bpp == 3)
+    for ( ; x + 16 <= w; x += 16, src += 48, dst += 16)
+    { uint8x16x3_t const p = vld3q_u8(src); vst1q_u8(dst, rgbToBayer16(p.val[ro], p.val[go], p.val[bo], oddrow)); }
+  else
+    for ( ; x + 16 <= w; x += 16, src += 64, dst += 16)
+    { uint8x16x4_t const p = vld4q_u8(src); vst1q_u8(dst, rgbToBayer16(p.val[ro], p.val[go], p.val[bo], oddrow)); }
+#elif defined(JEVOIS_CC_SSE)
+  if (bpp == 3)
+  {
+    if (lvl != JEVOIS_CC_SIMD_SHUFFLE) return 0;
+    for ( ; x + 16 <= w; x += 16, src += 48, dst += 16)
+    {
+      __m128i c[3]; deinterleave3(src, &c[0], &c[1], &c[2]);
+      _mm_storeu_si128((__m128i *)dst, rgbToBayer16(c[ro], c[go], c[bo], oddrow));
+    }
+  }
+  else
+    for ( ; x + 16 <= w; x += 16, src += 64, dst += 16)
+      _mm_storeu_si128((__m128i *)dst, rgbToBayer16(channel4(src, ro), channel4(src, go), channel4(src, bo), oddrow));
+#else
+  (void)w; (void)src; (void)dst; (void)ro; (void)go; (void)bo; (void)bpp; (void)oddrow; (void)lvl;
+#endif
+  return x;
+}
+
+static void toBayerconvert(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                           unsigned int y0, int ro, int go, int bo, int bpp)
+{
+  int const lvl = simdLevel();
+  unsigned int y;
+
+  for (y = y0; y < y0 + h; ++y)
+  {
+    unsigned int const x = lvl ? toBayerrowSIMD(w, src, dst, ro, go, bo, bpp, y & 1, lvl) : 0;
+    toBayerrowScalar(x, w, src, dst, ro, go, bo, bpp, y & 1);
+    src += w * bpp; dst += w;
+  }
+}
+
+// ####################################################################################################
+void convertRGB24toBayer(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                         unsigned int y0)
+{ toBayerconvert(w, h, src, dst, y0, 0, 1, 2, 3); }
+
+// ####################################################################################################
+void convertBGR24toBayer(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                         unsigned int y0)
+{ toBayerconvert(w, h, src, dst, y0, 2, 1, 0, 3); }
+
+// ####################################################################################################
+void convertRGBA32toBayer(unsigned int w, unsigned int h, unsigned char const * src, unsigned char * dst,
+                          unsigned int y0)
+{ toBayerconvert(w, h, src, dst, y0, 0, 1, 2, 4); }